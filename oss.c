@@ -4,6 +4,7 @@
 // Master process to simulate the OSS scheduler
 
 #include "project4.h"
+#include <spawn.h>
 
 /* Structures */
 // A structure to represent a queue
@@ -12,6 +13,20 @@ typedef struct {
 	unsigned capacity;
 	int *array;  
 } Queue;
+
+// A process waiting on simulated I/O and the simulated clock time at which the I/O completes
+typedef struct {
+	int pid;
+	int index;
+	unsigned int wakeTime[2];
+} BlockedProcess;
+
+// A min-heap of blocked processes ordered by wake-up time, so OSS only has to look at the earliest one
+typedef struct {
+	int size;
+	unsigned capacity;
+	BlockedProcess *array;
+} BlockedHeap;
                    
 /* Function Prototypes */
 // Queue functions
@@ -23,10 +38,36 @@ int dequeue ( Queue* queue );
 int front ( Queue* queue );
 int rear ( Queue* queue );
 
+// Blocked heap functions
+BlockedHeap* createBlockedHeap ( unsigned capacity );
+bool wakesBefore ( BlockedProcess *a, BlockedProcess *b );
+void pushBlocked ( BlockedHeap* heap, BlockedProcess item );
+BlockedProcess popBlocked ( BlockedHeap* heap );
+BlockedProcess* peekBlocked ( BlockedHeap* heap );
+
 // Other functions
 bool roomForProcess ( int size, int arr[] );
 int findIndex ( int size, int arr[] );
+int findProcessIndex ( int size, int arr[], int pid );
+void adjustQuantum ( ProcessControlBlock *pcb, bool usedFullQuantum );
+unsigned int clampQuantum ( unsigned int quantum );
+bool parseQuantum ( char *text, unsigned int *quantum );
+bool parseBatchSize ( char *text, int *batchSize );
+void printUsage ( char *name );
+void updateProcessControlBlock ( ProcessControlBlock *pcb, unsigned int burstTime );
+void setTimeInSystem ( ProcessControlBlock *pcb, unsigned int systemClock[] );
 bool timeForNewProcess ( unsigned int systemClock[], unsigned int nextProcessTimer );
+bool clockHasPassed ( unsigned int systemClock[], unsigned int time[] );
+pid_t spawnProcess ( int index );
+void recordReadyLatency ( long long latency );
+
+// Trace export functions
+void traceOpen ( char *name );
+void traceClose ( void );
+void traceSlice ( int track, int tid, char *name, unsigned int start[], unsigned int duration[], int pid );
+void traceInstant ( int track, int tid, char *name, unsigned int time[], int pid );
+void traceQueueDepth ( unsigned int time[], int high, int low, int blocked );
+void traceBurst ( unsigned int dispatchTime[], int queue, Message *msg );
 void cleanUpResources( void );
 
 /* Global Variables */
@@ -34,6 +75,53 @@ const int maxCurrentProcesses = 18;	// Controls how many child processes are all
 const int maxTotalProcesses = 100; 	// Controls how many child processes are allowed to be created in total
 const int killTimer = 2; 		// Controls the amount of seconds the program can be running
 int totalProcessesTerminated = 0;
+volatile sig_atomic_t terminateSignal = 0;	// Set by the signal handler. The main loop stops and cleans up when set.
+int maxSpawnBatch = 4;			// Controls how many due arrivals may be spawned in a single pass of the main loop
+
+// Time quantum control. Each process starts at baseQuantum (halved for high priority). Unless -s is given, OSS
+//	doubles the quantum of a process each time it uses all of it and halves it each time it does not, bounded by
+//	minQuantum and maxQuantum (-m and -M, in nanoseconds). The assigned quantum is sent in the dispatch message.
+const unsigned int baseQuantum = 50000;
+unsigned int minQuantum = 12500;
+unsigned int maxQuantum = 400000;
+bool adaptiveQuantum = true;
+
+// Scheduling statistics reported when OSS cleans up.
+long long totalDispatches = 0;
+long long turnaroundTotal = 0;		// Sum of simulated time in system (ns) of every terminated process
+long long cpuBusyTotal = 0;		// Sum of every burst (ns), used for CPU utilization
+long long cpuIdleTotal = 0;		// Simulated time (ns) the CPU sat idle while processes were blocked on I/O
+long long overheadTotal = 0;		// Simulated time (ns) added by the fixed per-pass clock increment
+
+// Process spawning. By default USER processes are started with fork/exec, which holds OSS up for the least time.
+//	The -p option uses posix_spawn instead, which glibc implements with clone ( CLONE_VM | CLONE_VFORK ) so OSS's
+//	page tables are never copied, at the cost of OSS waiting until the exec has happened.
+extern char **environ;
+bool useSpawn = false;
+char argIndex[12];			// Argument buffers handed to every USER: PCB index, message queue id,
+char argMessageID[12];			//	clock shared memory id and PCB shared memory id. The ids are
+char argClockID[12];			//	formatted once at startup; only the index changes per spawn.
+char argPCBID[12];
+char argSpawnTime[24];			// CLOCK_MONOTONIC time (ns) at which OSS started the spawn.
+char *userArgs[] = { "user", argIndex, argMessageID, argClockID, argPCBID, argSpawnTime, NULL };
+
+// Spawn latency statistics (real time, in nanoseconds) reported when OSS cleans up. The stall is how long OSS itself
+//	is held up by the spawn call. The ready latency runs from the same starting point until USER has exec'd and
+//	attached to shared memory, as reported by USER in its first reply, so the two spawn paths can be compared.
+long long spawnLatencyTotal = 0;
+long long spawnLatencyMax = 0;
+int spawnCount = 0;
+long long readyLatencyTotal = 0;
+long long readyLatencyMax = 0;
+int readyCount = 0;
+
+// Trace export. With -t, every creation, dispatch, burst, preemption, block and termination is streamed to a Chrome
+//	trace-event JSON file (loadable in chrome://tracing or Perfetto) using the simulated clock as the timeline. Events
+//	are never kept in memory, so runs of any length are fine. The exporter runs inline: each event is formatted with
+//	fprintf in the scheduling loop into a 1 MB stdio buffer, and the loop pays for the write whenever that fills.
+#define TRACE_CPU 1			// Trace "process" holding the simulated CPU track
+#define TRACE_SLOTS 2			// Trace "process" holding one track per PCB slot and the queue depth counters
+FILE *traceFile = NULL;
 
 // Logfile Access Pointer 
 FILE *fp;
@@ -52,9 +140,60 @@ int main ( int argc, char *argv[] ) {
 	int totalProcessesCreated = 0;	// Counter variable to track how many total processes have been created.
 	long ossPid = getpid();		// Hold the pid for OSS 
 	pid_t childPid;
+	int opt;			// Command line option being processed.
+	char *traceName = NULL;		// Trace file given with -t. Only opened once every option has been accepted.
 	
 	srand ( time ( NULL ) );	// Seed for OSS to generate random numbers when necessary.
 	
+	/* Command Line Options */
+	// -p : create USER processes with posix_spawn instead of fork/exec.
+	// -b n : spawn at most n due arrivals per pass of the main loop.
+	// -m n, -M n : minimum and maximum time quantum in nanoseconds.
+	// -s : static time quantum (disable the adaptive quantum).
+	// -t file : stream a Chrome trace-event timeline of the schedule to file.
+	while ( ( opt = getopt ( argc, argv, "pb:m:M:st:" ) ) != -1 ) {
+		switch ( opt ) {
+			case 'p':
+				useSpawn = true;
+				break;
+			case 'b':
+				if ( !parseBatchSize ( optarg, &maxSpawnBatch ) ) {
+					fprintf ( stderr, "OSS: Invalid batch size '%s'.\n", optarg );
+					printUsage ( argv[0] );
+					return 1;
+				}
+				break;
+			case 'm':
+				if ( !parseQuantum ( optarg, &minQuantum ) ) {
+					fprintf ( stderr, "OSS: Invalid minimum quantum '%s'.\n", optarg );
+					return 1;
+				}
+				break;
+			case 'M':
+				if ( !parseQuantum ( optarg, &maxQuantum ) ) {
+					fprintf ( stderr, "OSS: Invalid maximum quantum '%s'.\n", optarg );
+					return 1;
+				}
+				break;
+			case 's':
+				adaptiveQuantum = false;
+				break;
+			case 't':
+				traceName = optarg;
+				break;
+			default:
+				printUsage ( argv[0] );
+				return 1;
+		}
+	}
+	if ( minQuantum < 1 || minQuantum > maxQuantum ) {
+		fprintf ( stderr, "OSS: Minimum quantum must be at least 1 and no larger than the maximum quantum.\n" );
+		return 1;
+	}
+	if ( traceName != NULL ) {
+		traceOpen ( traceName );
+	}
+	
 	/* Output file */
 	int numberOfLines = 0; 			// Counter to track the size of the logfile (limited to 10,000 lines).
 	fp = fopen ( logName, "w+" );		// Opens file for writing. Logfile will be overwritten after each run. 
@@ -112,6 +251,11 @@ int main ( int argc, char *argv[] ) {
 		return 1; 
 	}
 	
+	// Format the IPC identifiers once so each USER can attach without looking the keys up again.
+	snprintf ( argMessageID, sizeof ( argMessageID ), "%d", messageID );
+	snprintf ( argClockID, sizeof ( argClockID ), "%d", shmClockID );
+	snprintf ( argPCBID, sizeof ( argPCBID ), "%d", shmPCBID );
+	
 	/* Main Loop Variables and Preparation */
 	// Setup of bit vector. Bit vector size determined by value of maxCurrentProcesses. Each index
 	//	will be set to 0 by default. Once a process is created, OSS will set the flag of an index
@@ -136,21 +280,32 @@ int main ( int argc, char *argv[] ) {
 	Queue* highPriorityQueue = createQueue ( maxCurrentProcesses );
 	Queue* lowPriorityQueue = createQueue ( maxCurrentProcesses );
 	
+	// Set up of the blocked set. Processes waiting on simulated I/O are kept in a min-heap ordered by the time
+	//	their I/O completes, so each pass only has to look at the earliest wake-up time.
+	BlockedHeap* blockedProcesses = createBlockedHeap ( maxCurrentProcesses );
+	BlockedProcess tempBlocked;
+	
 	// Other random variables that are only used in the main loop 
 	int processPriority;		// Will store the 0 or 1 (RNG) that will be assigned to each created process.
 	int rngPriority;		// Will stored the randomly generated number to control 
 	int tempBitVectorIndex = 0;	// Will store the current open index in the bit vector to be assigned to a new process.
-	bool createProcess;		// Flag to control when the process creation logic is entered. 
+	int spawnedThisLoop;		// Number of processes created during the current pass of the main loop.
 	int randOverhead;
 	long tempPid;
 	int tempChildPid;
 	int tempProcessIndex;
 	bool tempQuantumFlag;
 	bool tempTerminate;
+	bool tempBlock;
+	unsigned int tempDispatchTime[2];	// Simulated time at which the current dispatch started, for the trace.
+	unsigned int nextEventTime[2];		// Earliest time something could become ready when both queues are empty.
+	bool haveNextEvent;
+	bool fastForwarded;			// Set when an idle pass moved the clock straight to the next event.
+	bool spawnFailed = false;		// Set when a USER process could not be created. OSS stops and cleans up.
 		
 	/****** Main Loop ******/
 	// Loop will run until the maxTotalProcesses limit has been reached. 
-	while ( totalProcessesCreated < maxTotalProcesses ) {
+	while ( totalProcessesCreated < maxTotalProcesses && !terminateSignal && !spawnFailed ) {
 		
 		// Check to see if the logfile has reached its line limit. If so, set the flag to false so that no 
 		//	more file writes occur. 
@@ -158,44 +313,19 @@ int main ( int argc, char *argv[] ) {
 			keepWriting = false;
 		}
 		
-		// Set the createProcess flag to false as the default each run through the main loop. 
-		createProcess = false;
-		
-		// Check to see if the simulated system clock has passed the time for the next process to be created and
-		//	if there is room for a new process at this time. If both are true, change createProcess flag to 
-		//	true. Then set a new time for the next process to be created. 
-		if ( timeForNewProcess ( shmClock, nextProcessTimer ) && roomForProcess ( maxCurrentProcesses, bitVector ) ) {
-			createProcess = true;
-			rngTimer = ( rand() % ( 2 - 0 + 1 ) ) + 0; 
-			nextProcessTimer = rngTimer; 
-		}
-		
 		/* Process Creation */
-		// If the createProcess flag is set to true, OSS enters these branches first to create the new process
-		//	before it goes on to schedule anything. 
-		if ( createProcess ) {
-			tempBitVectorIndex = findIndex ( maxCurrentProcesses, bitVector );
-			childPid = fork();
-			
-			// Check for failure to fork child process.
-			if ( childPid < 0 ) {
-				perror ( "OSS: Failure to fork child process." );
-				kill ( getpid(), SIGINT );
-			}
+		// Create every process whose arrival time the simulated system clock has passed, as long as there is
+		//	room for it, up to maxSpawnBatch per pass. Each arrival schedules the next one a random amount
+		//	of time later, so arrivals that could not be created while the table was full are created in a
+		//	batch once slots free up. OSS creates processes before it goes on to schedule anything.
+		spawnedThisLoop = 0;
+		while ( totalProcessesCreated < maxTotalProcesses && spawnedThisLoop < maxSpawnBatch &&
+			timeForNewProcess ( shmClock, nextProcessTimer ) && roomForProcess ( maxCurrentProcesses, bitVector ) ) {
+			rngTimer = ( rand() % ( 2 - 0 + 1 ) ) + 0; 
+			nextProcessTimer += rngTimer; 
 			
-			// In the child process...
-			if ( childPid == 0 ) {
-				// Store child's pid in the associated index of the bit vector
-				bitVector[tempBitVectorIndex] = getpid();
-				
-				// To pass the index to the child process with exec, must first convert to string. 
-				char intBuffer[3];
-				sprintf ( intBuffer, "%d", tempBitVectorIndex );
-				
-				execl ( "./user", "user", intBuffer, NULL );
-			} // End of child process logic
+			tempBitVectorIndex = findIndex ( maxCurrentProcesses, bitVector );
 			
-			// In the parent process...
 			// Set the priority for newly created process.
 			rngPriority = ( rand() % ( 100 - 1 + 1 ) ) + 1;
 			if ( rngPriority >= 1 && rngPriority < 10 ) {
@@ -204,14 +334,29 @@ int main ( int argc, char *argv[] ) {
 				processPriority = 0; 	// Low priority
 			}
 			
-			// Fill in process control block info for child process to see. 
-			shmPCB[tempBitVectorIndex].pcb_ProcessID = childPid; 
+			// Fill in process control block info before spawning so the child never sees a stale slot.
 			shmPCB[tempBitVectorIndex].pcb_Priority = processPriority;
 			shmPCB[tempBitVectorIndex].pcb_TotalCPUTimeUsed[0] = 0;
 			shmPCB[tempBitVectorIndex].pcb_TotalCPUTimeUsed[1] = 0;
 			shmPCB[tempBitVectorIndex].pcb_TotalTimeInSystem[0] = 0;
 			shmPCB[tempBitVectorIndex].pcb_TotalTimeInSystem[1] = 0;
 			shmPCB[tempBitVectorIndex].pcb_TimeUsedLastBurst = 0;
+			shmPCB[tempBitVectorIndex].pcb_Quantum = clampQuantum ( ( processPriority == 1 ) ? baseQuantum / 2 : baseQuantum );
+			shmPCB[tempBitVectorIndex].pcb_TimeCreated[0] = shmClock[0];
+			shmPCB[tempBitVectorIndex].pcb_TimeCreated[1] = shmClock[1];
+			
+			childPid = spawnProcess ( tempBitVectorIndex );
+			
+			// Check for failure to create child process.
+			if ( childPid < 0 ) {
+				perror ( "OSS: Failure to create child process." );
+				spawnFailed = true;
+				break;
+			}
+			
+			// Store child's pid in the associated index of the bit vector and the process control block.
+			bitVector[tempBitVectorIndex] = childPid;
+			shmPCB[tempBitVectorIndex].pcb_ProcessID = childPid; 
 			
 			// Put the child process's pid the appropriate queue.
 			if ( processPriority == 0 ) {
@@ -231,9 +376,41 @@ int main ( int argc, char *argv[] ) {
 				enqueue ( highPriorityQueue, childPid );
 			}
 			
+			traceInstant ( TRACE_SLOTS, tempBitVectorIndex, "created", shmClock, childPid );
+			traceQueueDepth ( shmClock, highPriorityQueue->size, lowPriorityQueue->size, blockedProcesses->size );
+			
 			totalProcessesCreated++;
+			spawnedThisLoop++;
 		} // End of Create Process Logic
 		
+		// Stop before scheduling anything else if a process could not be created.
+		if ( spawnFailed ) {
+			break;
+		}
+		
+		fastForwarded = false;
+		
+		/* Waking Blocked Processes */
+		// Move every process whose I/O has completed by the current simulated time back to its ready queue.
+		//	The heap is ordered by wake-up time, so this stops at the first process that is still waiting.
+		while ( blockedProcesses->size > 0 && clockHasPassed ( shmClock, peekBlocked ( blockedProcesses )->wakeTime ) ) {
+			tempBlocked = popBlocked ( blockedProcesses );
+			processPriority = shmPCB[tempBlocked.index].pcb_Priority;
+			
+			if ( keepWriting ) {
+				fprintf ( fp, "OSS: Process %d finished its I/O and is placed back in queue %d at time %d:%d.\n", 
+					 tempBlocked.pid, processPriority, shmClock[0], shmClock[1] );
+				numberOfLines++;
+			}
+			
+			if ( processPriority == 1 ) {
+				enqueue ( highPriorityQueue, tempBlocked.pid );
+			} else {
+				enqueue ( lowPriorityQueue, tempBlocked.pid );
+			}
+			traceQueueDepth ( shmClock, highPriorityQueue->size, lowPriorityQueue->size, blockedProcesses->size );
+		}
+		
 		/* Scheduling */
 					 
 		// 1. Check high priority queue. If the queue is empty, continue to low priority branch. 
@@ -241,9 +418,13 @@ int main ( int argc, char *argv[] ) {
 			// Dequeue
 			tempPid = dequeue ( highPriorityQueue );
 			
-			// Set up message and send message to dequeued process to dispatch it. 
+			// Set up message and send message to dequeued process to dispatch it with its current quantum. 
 			message.msg_type = tempPid;
-			if ( msgsnd ( messageID, &message, sizeof ( message ), 0 ) == -1 ) {
+			message.quantum = shmPCB[findProcessIndex ( maxCurrentProcesses, bitVector, tempPid )].pcb_Quantum;
+			totalDispatches++;
+			tempDispatchTime[0] = shmClock[0];
+			tempDispatchTime[1] = shmClock[1];
+			if ( msgsnd ( messageID, &message, MESSAGE_SIZE, 0 ) == -1 ) {
 				perror ( "USER: Failure to send message." );
 			}
 			
@@ -253,14 +434,26 @@ int main ( int argc, char *argv[] ) {
 				numberOfLines++;
 			}
 			
-			// Wait for message from USER saying it has finished running for its allotted time. 
-			msgrcv ( messageID, &message, sizeof ( message ), ossPid, 0 ); 
+			// Wait for message from USER saying it has finished running for its allotted time. A signal
+			//	interrupts the wait, in which case stop and clean up.
+			if ( msgrcv ( messageID, &message, MESSAGE_SIZE, ossPid, 0 ) == -1 ) {
+				break;
+			}
 			
 			// Store values sent from USER in temp holders. 
 			tempChildPid = message.pid;
 			tempProcessIndex = message.processIndex; 
 			tempQuantumFlag = message.usedFullQuantum;
 			tempTerminate = message.terminated; 
+			tempBlock = message.blocked;
+			
+			// OSS is the only writer of the process control block. Record the burst reported by USER.
+			updateProcessControlBlock ( &shmPCB[tempProcessIndex], message.burstTime );
+			recordReadyLatency ( message.readyLatency );
+			cpuBusyTotal += message.burstTime;
+			if ( adaptiveQuantum ) {
+				adjustQuantum ( &shmPCB[tempProcessIndex], tempQuantumFlag );
+			}
 			
 			if ( keepWriting ) {
 				fprintf ( fp, "OSS: Process %d was able to run for %d seconds.\n", 
@@ -282,12 +475,32 @@ int main ( int argc, char *argv[] ) {
 			if ( tempTerminate ) {
 				totalProcessesTerminated++;		// Increment counter.
 				bitVector[tempProcessIndex] = 0;	// Unset bit in bit vector.
+				waitpid ( tempChildPid, NULL, 0 );	// Reap the terminated USER.
+				
+				// Record how long the process was alive now that it has left the system.
+				setTimeInSystem ( &shmPCB[tempProcessIndex], shmClock );
+				turnaroundTotal += shmPCB[tempProcessIndex].pcb_TotalTimeInSystem[0] * 1000000000LL + 
+					shmPCB[tempProcessIndex].pcb_TotalTimeInSystem[1];
 				
 				if ( keepWriting ) {
 					fprintf ( fp, "OSS: Process %d terminated at %d:%d.\n", tempProcessIndex, 
 						shmClock[0], shmClock[1] );
 					numberOfLines++;
 				}
+			} else if ( tempBlock ) {
+				// Process is waiting on I/O. Put it in the blocked set until the clock passes its wake-up time.
+				tempBlocked.pid = tempChildPid;
+				tempBlocked.index = tempProcessIndex;
+				tempBlocked.wakeTime[1] = shmClock[1] + message.blockTime[1];
+				tempBlocked.wakeTime[0] = shmClock[0] + message.blockTime[0] + tempBlocked.wakeTime[1] / 1000000000;
+				tempBlocked.wakeTime[1] = tempBlocked.wakeTime[1] % 1000000000;
+				pushBlocked ( blockedProcesses, tempBlocked );
+				
+				if ( keepWriting ) {
+					fprintf ( fp, "OSS: Process %d is blocked on I/O until %d:%d.\n", tempChildPid, 
+						tempBlocked.wakeTime[0], tempBlocked.wakeTime[1] );
+					numberOfLines++;
+				}
 			} else { 
 				// Put the child process's pid the appropriate queue.
 				if ( keepWriting ) {
@@ -297,15 +510,22 @@ int main ( int argc, char *argv[] ) {
 				}
 				enqueue ( highPriorityQueue, tempChildPid );
 			}
+			
+			traceBurst ( tempDispatchTime, 1, &message );
+			traceQueueDepth ( shmClock, highPriorityQueue->size, lowPriorityQueue->size, blockedProcesses->size );
 		} // End of checking high priority queue	
 		// 2. Check low priority queue. Same logic as above with high priority queue management.		
 		else if ( !isEmpty ( lowPriorityQueue ) ) {
 			// Dequeue
 			tempPid = dequeue ( lowPriorityQueue );
 			
-			// Set up message and send message to dequeued process to dispatch it. 
+			// Set up message and send message to dequeued process to dispatch it with its current quantum. 
 			message.msg_type = tempPid;
-			if ( msgsnd ( messageID, &message, sizeof ( message ), 0 ) == -1 ) {
+			message.quantum = shmPCB[findProcessIndex ( maxCurrentProcesses, bitVector, tempPid )].pcb_Quantum;
+			totalDispatches++;
+			tempDispatchTime[0] = shmClock[0];
+			tempDispatchTime[1] = shmClock[1];
+			if ( msgsnd ( messageID, &message, MESSAGE_SIZE, 0 ) == -1 ) {
 				perror ( "USER: Failure to send message." );
 			}
 			
@@ -315,14 +535,26 @@ int main ( int argc, char *argv[] ) {
 				numberOfLines++;
 			}
 			
-			// Wait for message from USER saying it has finished running for its allotted time. 
-			msgrcv ( messageID, &message, sizeof ( message ), ossPid, 0 ); 
+			// Wait for message from USER saying it has finished running for its allotted time. A signal
+			//	interrupts the wait, in which case stop and clean up.
+			if ( msgrcv ( messageID, &message, MESSAGE_SIZE, ossPid, 0 ) == -1 ) {
+				break;
+			}
 			
 			// Store values sent from USER in temp holders. 
 			tempChildPid = message.pid;
 			tempProcessIndex = message.processIndex; 
 			tempQuantumFlag = message.usedFullQuantum;
 			tempTerminate = message.terminated; 
+			tempBlock = message.blocked;
+			
+			// OSS is the only writer of the process control block. Record the burst reported by USER.
+			updateProcessControlBlock ( &shmPCB[tempProcessIndex], message.burstTime );
+			recordReadyLatency ( message.readyLatency );
+			cpuBusyTotal += message.burstTime;
+			if ( adaptiveQuantum ) {
+				adjustQuantum ( &shmPCB[tempProcessIndex], tempQuantumFlag );
+			}
 			
 			if ( keepWriting ) {
 				fprintf ( fp, "OSS: Process %d was able to run for %d seconds.\n", 
@@ -344,12 +576,32 @@ int main ( int argc, char *argv[] ) {
 			if ( tempTerminate ) {
 				totalProcessesTerminated++;		// Increment counter.
 				bitVector[tempProcessIndex] = 0;	// Unset bit in bit vector.
+				waitpid ( tempChildPid, NULL, 0 );	// Reap the terminated USER.
+				
+				// Record how long the process was alive now that it has left the system.
+				setTimeInSystem ( &shmPCB[tempProcessIndex], shmClock );
+				turnaroundTotal += shmPCB[tempProcessIndex].pcb_TotalTimeInSystem[0] * 1000000000LL + 
+					shmPCB[tempProcessIndex].pcb_TotalTimeInSystem[1];
 				
 				if ( keepWriting ) {
 					fprintf ( fp, "OSS: Process %d terminated at %d:%d.\n", tempProcessIndex, 
 						shmClock[0], shmClock[1] );
 					numberOfLines++;
 				}
+			} else if ( tempBlock ) {
+				// Process is waiting on I/O. Put it in the blocked set until the clock passes its wake-up time.
+				tempBlocked.pid = tempChildPid;
+				tempBlocked.index = tempProcessIndex;
+				tempBlocked.wakeTime[1] = shmClock[1] + message.blockTime[1];
+				tempBlocked.wakeTime[0] = shmClock[0] + message.blockTime[0] + tempBlocked.wakeTime[1] / 1000000000;
+				tempBlocked.wakeTime[1] = tempBlocked.wakeTime[1] % 1000000000;
+				pushBlocked ( blockedProcesses, tempBlocked );
+				
+				if ( keepWriting ) {
+					fprintf ( fp, "OSS: Process %d is blocked on I/O until %d:%d.\n", tempChildPid, 
+						tempBlocked.wakeTime[0], tempBlocked.wakeTime[1] );
+					numberOfLines++;
+				}
 			} else { 
 				// Put the child process's pid the appropriate queue.
 				if ( keepWriting ) {
@@ -359,23 +611,62 @@ int main ( int argc, char *argv[] ) {
 				}
 				enqueue ( lowPriorityQueue, tempChildPid );
 			}
+			
+			traceBurst ( tempDispatchTime, 0, &message );
+			traceQueueDepth ( shmClock, highPriorityQueue->size, lowPriorityQueue->size, blockedProcesses->size );
 		} // End of checking low priority queue
 		else {
 			if ( keepWriting ) {
 				fprintf ( fp, "OSS: No processes are in either ready queue. Incrementing clock.\n" );
 				numberOfLines++;
 			}
+			
+			// Nothing can run until the next event, so move the clock straight to it. The next event is the earliest
+			//	I/O completion or, if there is room for it and more are allowed, the next arrival, whichever is sooner.
+			haveNextEvent = false;
+			if ( blockedProcesses->size > 0 ) {
+				nextEventTime[0] = peekBlocked ( blockedProcesses )->wakeTime[0];
+				nextEventTime[1] = peekBlocked ( blockedProcesses )->wakeTime[1];
+				haveNextEvent = true;
+			}
+			if ( totalProcessesCreated < maxTotalProcesses && roomForProcess ( maxCurrentProcesses, bitVector ) &&
+				( !haveNextEvent || nextProcessTimer <= nextEventTime[0] ) ) {
+				nextEventTime[0] = nextProcessTimer;
+				nextEventTime[1] = 0;
+				haveNextEvent = true;
+			}
+			if ( haveNextEvent && !clockHasPassed ( shmClock, nextEventTime ) ) {
+				// Idle time only counts against utilization if something was waiting on I/O. With nothing
+				//	runnable or blocked, the system is simply empty until the next arrival.
+				if ( blockedProcesses->size > 0 ) {
+					cpuIdleTotal += ( nextEventTime[0] - ( long long ) shmClock[0] ) * 1000000000LL + 
+						( ( long long ) nextEventTime[1] - shmClock[1] );
+				}
+				shmClock[0] = nextEventTime[0];
+				shmClock[1] = nextEventTime[1];
+				fastForwarded = true;
+			}
 		}
 					 					 
-		// Increment clock 
-		randOverhead = ( rand() % ( 1000 - 0 + 1 ) ) + 0;
-		shmClock[0]++;
-		shmClock[1] += randOverhead;
-		shmClock[0] += shmClock[1] / 1000000000;
-		shmClock[1] = shmClock[1] % 1000000000;
+		// Increment clock. A pass that only moved the clock to the next event has no scheduling overhead to add.
+		if ( !fastForwarded ) {
+			randOverhead = ( rand() % ( 1000 - 0 + 1 ) ) + 0;
+			shmClock[0]++;
+			shmClock[1] += randOverhead;
+			shmClock[0] += shmClock[1] / 1000000000;
+			shmClock[1] = shmClock[1] % 1000000000;
+			overheadTotal += 1000000000LL + randOverhead;
+		}
 		
 	} // End of Main Loop
 	
+	if ( terminateSignal ) {
+		printf ( "Signal to terminate was received.\n" );
+	}
+	if ( spawnFailed ) {
+		printf ( "Stopping because a USER process could not be created.\n" );
+	}
+	
 	/* Detach from and delete shared memory segments. Delete message queue. Close the outfile. */
 	cleanUpResources();
 	
@@ -415,11 +706,21 @@ bool timeForNewProcess ( unsigned int systemClock[], unsigned int nextProcessTim
 		return false;
 }
 
-// Function to return the first available index in the bit vector.
+// Function to compare the shared memory clock with a stored clock time. Returns true if the system clock has
+//	reached or passed that time. Returns false otherwise.
+bool clockHasPassed ( unsigned int systemClock[], unsigned int time[] ) {
+	if ( systemClock[0] > time[0] || ( systemClock[0] == time[0] && systemClock[1] >= time[1] ) ) {
+		return true;
+	}
+	else
+		return false;
+}
+
+// Function to return the first available index in the bit vector. Returns -1 if every index is in use.
 int findIndex ( int size, int arr[] ) {
-	int index, i;
+	int index = -1, i;
 	for ( i = 0; i < size; ++i ) {
-		if ( arr[i] != 0 ) {
+		if ( arr[i] == 0 ) {
 			index = i;
 			break;
 		}
@@ -428,12 +729,298 @@ int findIndex ( int size, int arr[] ) {
 	return index;
 }
 
+// Function to return the index in the bit vector (and process control block) that belongs to the given pid. 
+//	Returns -1 if the pid is not found.
+int findProcessIndex ( int size, int arr[], int pid ) {
+	int i;
+	for ( i = 0; i < size; ++i ) {
+		if ( arr[i] == pid ) {
+			return i;
+		}
+	}
+	
+	return -1;
+}
+
+// Function to adapt the time quantum of a process after a burst. A process that used its whole quantum is
+//	treated as CPU-bound and gets twice as much next time so it needs fewer dispatches. A process that gave
+//	up the CPU early is treated as interactive and gets half as much. The result stays within the min/max bounds.
+void adjustQuantum ( ProcessControlBlock *pcb, bool usedFullQuantum ) {
+	if ( usedFullQuantum ) {
+		pcb->pcb_Quantum = ( pcb->pcb_Quantum > maxQuantum / 2 ) ? maxQuantum : pcb->pcb_Quantum * 2;
+	} else {
+		pcb->pcb_Quantum = pcb->pcb_Quantum / 2;
+	}
+	
+	pcb->pcb_Quantum = clampQuantum ( pcb->pcb_Quantum );
+}
+
+// Function to keep a quantum within the minQuantum and maxQuantum bounds.
+unsigned int clampQuantum ( unsigned int quantum ) {
+	if ( quantum < minQuantum ) {
+		return minQuantum;
+	}
+	if ( quantum > maxQuantum ) {
+		return maxQuantum;
+	}
+	
+	return quantum;
+}
+
+// Function to parse a quantum given on the command line. Accepts a whole number of nanoseconds from 1 up to one
+//	second, so a burst can always be added to the nanoseconds of the clock without overflowing. Returns false for
+//	anything else, including negative numbers, which strtoul would otherwise wrap around.
+bool parseQuantum ( char *text, unsigned int *quantum ) {
+	char *end;
+	unsigned long value;
+	
+	if ( text[0] < '0' || text[0] > '9' ) {
+		return false;
+	}
+	
+	errno = 0;
+	value = strtoul ( text, &end, 10 );
+	if ( errno != 0 || *end != '\0' || value < 1 || value > 1000000000 ) {
+		return false;
+	}
+	
+	*quantum = ( unsigned int ) value;
+	return true;
+}
+
+// Function to parse the batch size given with -b. Accepts a whole number from 1 up to maxTotalProcesses, since no
+//	pass can create more processes than that. Returns false for anything else.
+bool parseBatchSize ( char *text, int *batchSize ) {
+	char *end;
+	unsigned long value;
+	
+	if ( text[0] < '0' || text[0] > '9' ) {
+		return false;
+	}
+	
+	errno = 0;
+	value = strtoul ( text, &end, 10 );
+	if ( errno != 0 || *end != '\0' || value < 1 || value > maxTotalProcesses ) {
+		return false;
+	}
+	
+	*batchSize = ( int ) value;
+	return true;
+}
+
+// Function to print the command line options OSS accepts.
+void printUsage ( char *name ) {
+	fprintf ( stderr, "Usage: %s [-p] [-b batchSize] [-m minQuantum] [-M maxQuantum] [-s] [-t traceFile]\n", name );
+}
+
+// Function to record a completed burst in a process control block. Only OSS calls this so the PCB has
+//	exactly one writer.
+void updateProcessControlBlock ( ProcessControlBlock *pcb, unsigned int burstTime ) {
+	pcb->pcb_TimeUsedLastBurst = burstTime;
+	pcb->pcb_TotalCPUTimeUsed[1] += burstTime;
+	pcb->pcb_TotalCPUTimeUsed[0] += pcb->pcb_TotalCPUTimeUsed[1] / 1000000000;
+	pcb->pcb_TotalCPUTimeUsed[1] = pcb->pcb_TotalCPUTimeUsed[1] % 1000000000;
+}
+
+// Function to set the total time in system for a process control block from the time the process was created
+//	to the current simulated system clock.
+void setTimeInSystem ( ProcessControlBlock *pcb, unsigned int systemClock[] ) {
+	unsigned int seconds = systemClock[0] - pcb->pcb_TimeCreated[0];
+	unsigned int nanoseconds; 
+	
+	if ( systemClock[1] >= pcb->pcb_TimeCreated[1] ) {
+		nanoseconds = systemClock[1] - pcb->pcb_TimeCreated[1];
+	} else {
+		seconds--;
+		nanoseconds = systemClock[1] + 1000000000 - pcb->pcb_TimeCreated[1];
+	}
+	
+	pcb->pcb_TotalTimeInSystem[0] = seconds;
+	pcb->pcb_TotalTimeInSystem[1] = nanoseconds;
+}
+
+// Function to create a USER process for the given PCB index. Uses fork/exec unless -p was given, in which
+//	case posix_spawn is used. Returns the new pid or -1 on failure. The real time OSS spends in
+//	the call is added to the spawn stall statistics.
+pid_t spawnProcess ( int index ) {
+	struct timespec start, end;
+	long long latency;
+	pid_t pid;
+	
+	clock_gettime ( CLOCK_MONOTONIC, &start );
+	snprintf ( argIndex, sizeof ( argIndex ), "%d", index );
+	snprintf ( argSpawnTime, sizeof ( argSpawnTime ), "%lld", start.tv_sec * 1000000000LL + start.tv_nsec );
+	
+	if ( useSpawn ) {
+		errno = posix_spawn ( &pid, "./user", NULL, NULL, userArgs, environ );
+		if ( errno != 0 ) {
+			pid = -1;
+		}
+	} else {
+		pid = fork();
+		if ( pid == 0 ) {
+			execv ( "./user", userArgs );
+			perror ( "OSS: Failure to exec user." );
+			_exit ( 1 );
+		}
+	}
+	clock_gettime ( CLOCK_MONOTONIC, &end );
+	
+	if ( pid > 0 ) {
+		latency = ( end.tv_sec - start.tv_sec ) * 1000000000LL + ( end.tv_nsec - start.tv_nsec );
+		spawnLatencyTotal += latency;
+		if ( latency > spawnLatencyMax ) {
+			spawnLatencyMax = latency;
+		}
+		spawnCount++;
+	}
+	
+	return pid;
+}
+
+// Function to add the ready latency USER reported in its first reply to the spawn statistics. Later replies
+//	carry 0 and are ignored.
+void recordReadyLatency ( long long latency ) {
+	if ( latency <= 0 )
+		return;
+	
+	readyLatencyTotal += latency;
+	if ( latency > readyLatencyMax ) {
+		readyLatencyMax = latency;
+	}
+	readyCount++;
+}
+
+// Function to open the trace file given with -t. Writes the start of the JSON array and names the tracks.
+void traceOpen ( char *name ) {
+	int i;
+	
+	if ( ( traceFile = fopen ( name, "w" ) ) == NULL ) {
+		perror ( "OSS: Failure to open trace file." );
+		return;
+	}
+	setvbuf ( traceFile, NULL, _IOFBF, 1 << 20 );
+	
+	fprintf ( traceFile, "[\n{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\",\"args\":{\"name\":\"Simulated CPU\"}}", TRACE_CPU );
+	fprintf ( traceFile, ",\n{\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"name\":\"thread_name\",\"args\":{\"name\":\"CPU 0\"}}", TRACE_CPU );
+	fprintf ( traceFile, ",\n{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\",\"args\":{\"name\":\"PCB slots\"}}", TRACE_SLOTS );
+	for ( i = 0; i < maxCurrentProcesses; ++i ) {
+		fprintf ( traceFile, ",\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"Slot %d\"}}", 
+			TRACE_SLOTS, i, i );
+	}
+}
+
+// Function to finish the JSON array and close the trace file.
+void traceClose() {
+	if ( traceFile == NULL )
+		return;
+	
+	fprintf ( traceFile, "\n]\n" );
+	fclose ( traceFile );
+	traceFile = NULL;
+}
+
+// Trace timestamps are in microseconds. Print a simulated clock time as microseconds keeping nanosecond precision.
+#define TRACE_TIME(t) ( ( t )[0] * 1000000ULL + ( t )[1] / 1000 ), ( ( t )[1] % 1000 )
+
+// Function to write a complete ("X") event covering [start, start + duration) on the given track.
+void traceSlice ( int track, int tid, char *name, unsigned int start[], unsigned int duration[], int pid ) {
+	if ( traceFile == NULL )
+		return;
+	
+	fprintf ( traceFile, ",\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\",\"ts\":%llu.%03u,\"dur\":%llu.%03u,\"args\":{\"pid\":%d}}", 
+		track, tid, name, TRACE_TIME ( start ), TRACE_TIME ( duration ), pid );
+}
+
+// Function to write an instant ("i") event on the given track.
+void traceInstant ( int track, int tid, char *name, unsigned int time[], int pid ) {
+	if ( traceFile == NULL )
+		return;
+	
+	fprintf ( traceFile, ",\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\",\"ts\":%llu.%03u,\"args\":{\"pid\":%d}}", 
+		track, tid, name, TRACE_TIME ( time ), pid );
+}
+
+// Function to write a counter ("C") event with the current depth of both ready queues and the blocked set.
+void traceQueueDepth ( unsigned int time[], int high, int low, int blocked ) {
+	if ( traceFile == NULL )
+		return;
+	
+	fprintf ( traceFile, ",\n{\"ph\":\"C\",\"pid\":%d,\"name\":\"queue depth\",\"ts\":%llu.%03u,\"args\":{\"queue 1\":%d,\"queue 0\":%d,\"blocked\":%d}}", 
+		TRACE_SLOTS, TRACE_TIME ( time ), high, low, blocked );
+}
+
+// Function to trace one dispatch from the completion message USER sent back. The burst is drawn on the CPU track and
+//	on the process's slot, followed by how the burst ended: terminated, blocked on I/O, or preempted when the
+//	quantum ran out. A burst that ended early without blocking needs no extra event.
+void traceBurst ( unsigned int dispatchTime[], int queue, Message *msg ) {
+	unsigned int burst[2] = { 0, msg->burstTime };
+	unsigned int end[2];
+	char name[32];
+	
+	if ( traceFile == NULL )
+		return;
+	
+	end[1] = dispatchTime[1] + msg->burstTime;
+	end[0] = dispatchTime[0] + end[1] / 1000000000;
+	end[1] = end[1] % 1000000000;
+	
+	snprintf ( name, sizeof ( name ), "PID %d (queue %d)", msg->pid, queue );
+	traceSlice ( TRACE_CPU, 0, name, dispatchTime, burst, msg->pid );
+	fprintf ( traceFile, ",\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"name\":\"running\",\"ts\":%llu.%03u,\"dur\":%llu.%03u,\"args\":{\"pid\":%d,\"queue\":%d,\"quantum\":%u,\"burst\":%u}}", 
+		TRACE_SLOTS, msg->processIndex, TRACE_TIME ( dispatchTime ), TRACE_TIME ( burst ), msg->pid, queue, msg->quantum, msg->burstTime );
+	
+	if ( msg->terminated ) {
+		traceInstant ( TRACE_SLOTS, msg->processIndex, "terminated", end, msg->pid );
+	} else if ( msg->blocked ) {
+		traceSlice ( TRACE_SLOTS, msg->processIndex, "blocked on I/O", end, msg->blockTime, msg->pid );
+	} else if ( msg->usedFullQuantum ) {
+		traceInstant ( TRACE_SLOTS, msg->processIndex, "preempted", end, msg->pid );
+	}
+}
 
 // Function to terminate all shared memory and message queue up completion or to work with signal handling
 void cleanUpResources() {
+	double simulatedSeconds;
+	
 	// Close the file
 	fclose ( fp );
 	printf ( "Closed %s\n.", logName );
+	traceClose();
+	
+	// Report how long it took to create the USER processes.
+	if ( spawnCount > 0 ) {
+		printf ( "Spawned %d processes with %s: OSS stall average %lld ns, max %lld ns.\n", spawnCount, 
+			useSpawn ? "posix_spawn" : "fork/exec", spawnLatencyTotal / spawnCount, spawnLatencyMax );
+	}
+	if ( readyCount > 0 ) {
+		printf ( "Time until USER ready (%d processes): average %lld ns, max %lld ns.\n", readyCount, 
+			readyLatencyTotal / readyCount, readyLatencyMax );
+	}
+	
+	// Report scheduling statistics in terms of the simulated system clock. The dispatch rate is taken over the time
+	//	USER processes actually ran, since every pass of the main loop also adds a fixed second of clock overhead.
+	simulatedSeconds = shmClock[0] + shmClock[1] / 1000000000.0;
+	if ( cpuBusyTotal > 0 ) {
+		printf ( "%lld dispatches with %s quantum (%.0f per simulated CPU-second).\n", totalDispatches, 
+			adaptiveQuantum ? "adaptive" : "static", totalDispatches / ( cpuBusyTotal / 1000000000.0 ) );
+	}
+	// CPU utilization is taken over the time something was running or waiting on I/O: bursts plus the idle time
+	//	OSS skipped while every live process was blocked. The fixed per-pass overhead is left out and reported
+	//	on its own, since it would otherwise swamp the figure.
+	if ( cpuBusyTotal + cpuIdleTotal > 0 ) {
+		printf ( "CPU utilization: %.2f%% (busy %.6f s, idle waiting on I/O %.6f s).\n", 
+			100.0 * cpuBusyTotal / ( cpuBusyTotal + cpuIdleTotal ), cpuBusyTotal / 1000000000.0, 
+			cpuIdleTotal / 1000000000.0 );
+	}
+	if ( simulatedSeconds > 0 ) {
+		printf ( "Scheduler overhead: %.3f of %.3f simulated seconds (not counted in CPU utilization).\n", 
+			overheadTotal / 1000000000.0, simulatedSeconds );
+	}
+	if ( totalProcessesTerminated > 0 ) {
+		printf ( "Average turnaround of %d terminated processes: %.3f simulated seconds.\n", totalProcessesTerminated, 
+			turnaroundTotal / ( totalProcessesTerminated * 1000000000.0 ) );
+	}
 	
 	// Detach from shared memory
 	printf ( "Detaching from shared memory...\n" );
@@ -451,14 +1038,14 @@ void cleanUpResources() {
 }
 
 // Function for signal handling.
-// Handles ctrl-c from keyboard or eclipsing 2 real life seconds in run-time.
+// Handles ctrl-c from keyboard or eclipsing 2 real life seconds in run-time. Only sets a flag so the main loop
+//	can finish what it is writing (log, trace) and clean up outside the handler. A blocked msgrcv is interrupted
+//	by the signal. The alarm is re-armed in case OSS is stuck waiting on a USER that has already gone, so the
+//	next SIGALRM interrupts that wait. USER processes exit once the message queue is removed.
 void sig_handle ( int sig_num ) {
 	if ( sig_num == SIGINT || sig_num == SIGALRM ) {
-		printf ( "Signal to terminate was received.\n" );
-		cleanUpResources();
-		kill ( 0, SIGKILL );
-		wait ( NULL );
-		exit ( 0 );
+		terminateSignal = sig_num;
+		alarm ( 1 );
 	}
 }
 
@@ -525,3 +1112,65 @@ int rear ( Queue* queue ) {
 
 	return queue->array[queue->rear];
 }
+
+// Function to create a blocked heap of given capacity. It initializes size of heap as 0.
+BlockedHeap* createBlockedHeap ( unsigned capacity ) {
+	BlockedHeap* heap = (BlockedHeap*) malloc ( sizeof ( BlockedHeap ) );
+	heap->capacity = capacity;
+	heap->size = 0;
+	heap->array = (BlockedProcess*) malloc ( heap->capacity * sizeof ( BlockedProcess ) );
+
+	return heap;
+}
+
+// Returns true if process a wakes up before process b.
+bool wakesBefore ( BlockedProcess *a, BlockedProcess *b ) {
+	return ( a->wakeTime[0] < b->wakeTime[0] || 
+		( a->wakeTime[0] == b->wakeTime[0] && a->wakeTime[1] < b->wakeTime[1] ) );
+}
+
+// Function to add a process to the heap. The new item is sifted up until its parent wakes no later than it.
+void pushBlocked ( BlockedHeap* heap, BlockedProcess item ) {
+	int i, parent;
+	
+	if ( heap->size == heap->capacity )
+		return;
+	
+	i = heap->size++;
+	while ( i > 0 ) {
+		parent = ( i - 1 ) / 2;
+		if ( !wakesBefore ( &item, &heap->array[parent] ) )
+			break;
+		heap->array[i] = heap->array[parent];
+		i = parent;
+	}
+	heap->array[i] = item;
+}
+
+// Function to remove the process with the earliest wake-up time from the heap. The last item is moved to the
+//	root and sifted down. Must not be called on an empty heap.
+BlockedProcess popBlocked ( BlockedHeap* heap ) {
+	BlockedProcess top = heap->array[0];
+	BlockedProcess last = heap->array[--heap->size];
+	int i = 0, child;
+	
+	while ( ( child = 2 * i + 1 ) < heap->size ) {
+		if ( child + 1 < heap->size && wakesBefore ( &heap->array[child + 1], &heap->array[child] ) )
+			child++;
+		if ( !wakesBefore ( &heap->array[child], &last ) )
+			break;
+		heap->array[i] = heap->array[child];
+		i = child;
+	}
+	heap->array[i] = last;
+
+	return top;
+}
+
+// Function to get the process with the earliest wake-up time without removing it.
+BlockedProcess* peekBlocked ( BlockedHeap* heap ) {
+	if ( heap->size == 0 )
+		return NULL;
+
+	return &heap->array[0];
+}
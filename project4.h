@@ -31,17 +31,30 @@ typedef struct {
 	unsigned int pcb_TotalCPUTimeUsed[2];	// Running counter of time when process was running after being scheduled
 	unsigned int pcb_TotalTimeInSystem[2];	// Running counter of time when process was alive
 	unsigned int pcb_TimeUsedLastBurst;	// Temporary tracker or most recent amount of time spent running
+	unsigned int pcb_TimeCreated[2];	// Simulated clock time at which OSS created the process
+	unsigned int pcb_Quantum;		// Time quantum (ns) OSS will hand the process on its next dispatch
 } ProcessControlBlock;
 
+// Note: OSS is the only writer of the process control block. USER processes attach to it read-only and
+//	report everything about a burst (length, full quantum flag, termination) in their completion message.
+
 // Structure used in the message queue 
 typedef struct {
 	long msg_type;		// Control what process can receive the message.
 	int pid;		// Store the sending process's pid.
 	int processIndex;	// Store the sending process's index in the process control block and bit vector.
+	unsigned int quantum;	// Time quantum (ns) assigned by OSS when dispatching the process.
+	unsigned int burstTime;	// Amount of time (ns) the process ran during the burst being reported.
 	bool usedFullQuantum;	// Flag to indicate if the process was able to run for its full time quantum. 
 	bool terminated;	// Flag to indicate that the process was able to terminate. 
+	bool blocked;		// Flag to indicate that the process gave up the CPU to wait on simulated I/O.
+	unsigned int blockTime[2];	// How long (seconds, nanoseconds) the I/O will take when blocked is set.
+	long long readyLatency;	// First reply only: real time (ns) from OSS starting the spawn until USER was ready.
 } Message;
 
+// Size of the message payload (everything after msg_type) for msgsnd/msgrcv.
+#define MESSAGE_SIZE ( sizeof ( Message ) - sizeof ( long ) )
+
 /* Function prototypes */
 // Function to handle any termination signals from either OSS or USER.
 void sig_handle ( int sig_num );
@@ -4,19 +4,19 @@
 // User process which is generated and scheduled by OSS
 #include "project4.h"
 
-const unsigned int baseQuantum = 50000;
-
 int main ( int argc, char *argv[] ) {
 	/* General Variables */
 	int myPid = getpid();			// Store process ID.
 	long ossPid = getppid();		// Store parent process ID.
 	int tableIndex = atoi ( argv[1] );	// Store process control block index passed from OSS. 
-	int priority;				// Store the priority that is in the process control block.
-	unsigned int timeCreated[2];		// Store the the process entered the system. 
-	unsigned int quantum;			// Time quantum for whenever process is dispatched. 
+	unsigned int quantum;			// Time quantum OSS assigned for the current dispatch. 
 	int timeSlice; 				// Will determine how much of the quantum the process uses each dispatch
 	int randTerminate;			// Will randomly determine if the process terminated. 
-	unsigned timeSliceUsed; 
+	unsigned int timeSliceUsed;		// Amount of the quantum used during the current burst.
+	unsigned int cpuTimeUsed[2] = { 0, 0 };	// Private running total of CPU time. OSS keeps the official copy in the PCB.
+	bool terminating;			// Flag set once the process decides to terminate during this burst.
+	long long readyLatency = 0;		// Real time (ns) from OSS starting the spawn until this process was ready.
+	struct timespec now;
 	
 	/* USER-specific seed for random number generation */
 	time_t childSeed;
@@ -28,125 +28,110 @@ int main ( int argc, char *argv[] ) {
 	}
 	
 	/* Attach to shared memory */
-	// Find shared memory for simulated system clock.
-	if ( ( shmClockID = shmget ( shmClockKey, ( 2 * ( sizeof ( unsigned int ) ) ), IPC_CREAT ) ) == -1 ) {
-		perror ( "USER: Failure to get shared memory space for simulated system clock." );
-		return 1;
-	}
-	
-	// Find shared memory for process control block.
-	if ( ( shmPCBID = shmget ( shmPCBKey, ( 18 * ( sizeof ( ProcessControlBlock ) ) ), IPC_CREAT ) ) == -1 ) {
-		perror ( "USER: Failure to get shared memory space for Process Control Block." );
-		return 1;
+	// OSS passes the IPC identifiers after the PCB index. Fall back to looking them up by key if they are missing.
+	if ( argc >= 5 ) {
+		messageID = atoi ( argv[2] );
+		shmClockID = atoi ( argv[3] );
+		shmPCBID = atoi ( argv[4] );
+	} else {
+		// Find shared memory for simulated system clock.
+		if ( ( shmClockID = shmget ( shmClockKey, ( 2 * ( sizeof ( unsigned int ) ) ), IPC_CREAT ) ) == -1 ) {
+			perror ( "USER: Failure to get shared memory space for simulated system clock." );
+			return 1;
+		}
+		
+		// Find shared memory for process control block.
+		if ( ( shmPCBID = shmget ( shmPCBKey, ( 18 * ( sizeof ( ProcessControlBlock ) ) ), IPC_CREAT ) ) == -1 ) {
+			perror ( "USER: Failure to get shared memory space for Process Control Block." );
+			return 1;
+		}
+		
+		// Access message queue.
+		if ( ( messageID = msgget ( messageKey, IPC_CREAT | 0666 ) ) == -1 ) {
+			perror ( "USER: Failure to create the message queue." );
+			return 1; 
+		}
 	}
 	
-	// Attach to shared memory for simulated system clock
-	if ( ( shmClock = (unsigned int *) shmat ( shmClockID, NULL, 0 ) ) < 0 ) {
+	// Attach to shared memory for simulated system clock. USER only ever reads the clock.
+	if ( ( shmClock = (unsigned int *) shmat ( shmClockID, NULL, SHM_RDONLY ) ) < 0 ) {
 		perror ( "USER: Failure to attach to shared memory space for simulated system clock." );
 		return 1; 
 	}
 	
-	// Set the time the process was created after attaching to shared memory clock.
-	timeCreated[0] = shmClock[0];
-	timeCreated[1] = shmClock[1];
-	
-	// Attach to shared memory for Process Control Block.
-	if ( ( shmPCB = (ProcessControlBlock *) shmat ( shmPCBID, NULL, 0 ) ) < 0 ) {
+	// Attach to shared memory for Process Control Block. OSS is the only writer, so attach read-only.
+	if ( ( shmPCB = (ProcessControlBlock *) shmat ( shmPCBID, NULL, SHM_RDONLY ) ) < 0 ) {
 		perror ( "USER: Failure to attach to shared memory space for Process Control Block." );
 		return 1;
 	}
 	
-	// Determine time quantum based off of process priorirty stored in process control block. 
-	priority = shmPCB[tableIndex].pcb_Priority;
-	if ( priority == 1 ) {
-		quantum = baseQuantum / 2;
-	} else {
-		quantum = baseQuantum; 
-	}
-	
-	/* Message Queue */
-	// Access message queue.
-	if ( ( messageID = msgget ( messageKey, IPC_CREAT | 0666 ) ) == -1 ) {
-		perror ( "USER: Failure to create the message queue." );
-		return 1; 
+	// Work out how long it took from OSS starting the spawn until this process was ready to be dispatched. The
+	//	result goes back to OSS in the first reply.
+	if ( argc >= 6 ) {
+		clock_gettime ( CLOCK_MONOTONIC, &now );
+		readyLatency = now.tv_sec * 1000000000LL + now.tv_nsec - atoll ( argv[5] );
 	}
 	
 	/* Main Loop */
 	while ( 1 ) {
 		// Wait until a message is received from OSS which will indicate the process was dispatched.
-		// Blocked until a message is received. 
-		msgrcv ( messageID, &message, sizeof ( message ), myPid, 0 ); 
+		// Blocked until a message is received. If the queue has been removed, OSS is gone, so stop.
+		if ( msgrcv ( messageID, &message, MESSAGE_SIZE, myPid, 0 ) == -1 ) {
+			break;
+		}
+		quantum = message.quantum;
 		
 		// Determine if process will terminate. Process must have accumulated at least 50 milliseconds of
 		//	total CPU time. 
-		if ( shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] >= 500000 ) {
+		terminating = false;
+		if ( cpuTimeUsed[1] >= 500000 ) {
 			randTerminate = ( rand() % ( 100 - 0 + 1) ) + 0;
 			if ( randTerminate >= 0 && randTerminate < 25 ) {
-				// Process has decided it is able to terminate. 
-				// Determine how much of time slice was used during this last run. Randomly generate a 1 or 0.
-				//	0 indicates whole time slice was used. 1 indicates just a portion was used. 
-				timeSlice = ( rand() % ( 1 - 0 + 1 ) ) + 0;
-				if ( timeSlice == 0 ) {
-					message.usedFullQuantum = true;
-					shmPCB[tableIndex].pcb_TimeUsedLastBurst = quantum;
-					shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] += quantum; 
-					shmPCB[tableIndex].pcb_TotalCPUTimeUsed[0] += shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] / 1000000000;
-					shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] = shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] % 1000000000;
-				}
-				if ( timeSlice == 1 ) {
-					message.usedFullQuantum = false;
-					timeSliceUsed = ( rand() % ( quantum - 0 + 1 ) ) + 0;
-					shmPCB[tableIndex].pcb_TimeUsedLastBurst = timeSliceUsed;
-					shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] += timeSliceUsed; 
-					shmPCB[tableIndex].pcb_TotalCPUTimeUsed[0] += shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] / 1000000000;
-					shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] = shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] % 1000000000;
-				}				
-				
-				// Update total time in system by subtracting the time it entered the system from the current
-				//	time in the simulated system clock. 
-				shmPCB[tableIndex].pcb_TotalTimeInSystem[0] = shmClock[0] - timeCreated[0];
-				shmPCB[tableIndex].pcb_TotalTimeInSystem[1] = shmClock[1] - timeCreated[1];
-
-				// Send message to OSS indicating that the process has terminated.
-				message.msg_type = ossPid;		
-				message.pid = myPid;		
-				message.processIndex = tableIndex;	
-				message.terminated = true;	
-				
-				if ( msgsnd ( messageID, &message, sizeof ( message ), 0 ) == -1 ) {
-					perror ( "USER: Failure to send message." );
-				}
-				break;
+				terminating = true;
 			}
-		} // End of terminate branch
+		}
 		
-		// If process isn't terminating, determine how much of time quantum process will use. 
+		// Determine how much of time slice was used during this run. Randomly generate a 1 or 0.
+		//	0 indicates whole time slice was used. 1 indicates just a portion was used. 
 		timeSlice = ( rand() % ( 1 - 0 + 1 ) ) + 0;
 		if ( timeSlice == 0 ) {
 			message.usedFullQuantum = true;
-			shmPCB[tableIndex].pcb_TimeUsedLastBurst = quantum;
-			shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] += quantum; 
-			shmPCB[tableIndex].pcb_TotalCPUTimeUsed[0] += shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] / 1000000000;
-			shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] = shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] % 1000000000;
-		}
-		if ( timeSlice == 1 ) {
+			timeSliceUsed = quantum;
+		} else {
 			message.usedFullQuantum = false;
 			timeSliceUsed = ( rand() % ( quantum - 0 + 1 ) ) + 0;
-			shmPCB[tableIndex].pcb_TimeUsedLastBurst = timeSliceUsed;
-			shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] += timeSliceUsed; 
-			shmPCB[tableIndex].pcb_TotalCPUTimeUsed[0] += shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] / 1000000000;
-			shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] = shmPCB[tableIndex].pcb_TotalCPUTimeUsed[1] % 1000000000;
 		}
+		
+		// A process that gave up the CPU early and is not terminating may be waiting on an I/O event. Half of
+		//	the time, block for r.s seconds where r is in [0,5] seconds and s is in [0,1000] milliseconds.
+		message.blocked = false;
+		if ( !terminating && !message.usedFullQuantum && ( rand() % 2 ) == 0 ) {
+			message.blocked = true;
+			message.blockTime[0] = ( rand() % ( 5 - 0 + 1 ) ) + 0;
+			message.blockTime[1] = ( ( rand() % ( 1000 - 0 + 1 ) ) + 0 ) * 1000000;
+		}
+		
+		// Keep a private running total so the termination check never has to touch the PCB.
+		cpuTimeUsed[1] += timeSliceUsed;
+		cpuTimeUsed[0] += cpuTimeUsed[1] / 1000000000;
+		cpuTimeUsed[1] = cpuTimeUsed[1] % 1000000000;
 
-		// Send message to OSS indicating that the process has finished reached its quantum or slice of quantum.
+		// Send message to OSS reporting the burst. OSS does all of the PCB accounting from these values.
 		message.msg_type = ossPid;		
 		message.pid = myPid;		
 		message.processIndex = tableIndex;	
-		message.terminated = false;	
+		message.burstTime = timeSliceUsed;
+		message.terminated = terminating;	
+		message.readyLatency = readyLatency;
+		readyLatency = 0;
 
-		if ( msgsnd ( messageID, &message, sizeof ( message ), 0 ) == -1 ) {
+		if ( msgsnd ( messageID, &message, MESSAGE_SIZE, 0 ) == -1 ) {
 			perror ( "USER: Failure to send message." );
 		}
+		
+		if ( terminating ) {
+			break;
+		}
 	} // End of main loop
 	
 	return 0;